@@ -0,0 +1,168 @@
+// sample code writing one hour of frames to a compressed archive in memory,
+// reading it back, comparing all values and measuring size and decoding speed
+// NOTE for timing build with debugging output off (build_flags = -D VERBOSE=0)
+
+#include <Arduino.h>
+#include <VEdirect.h>
+#include <VEarchive.h>
+
+// keys for SmartSolar MPPT charger
+const VEdirect::VEkey SmartSolarKeys[] = {
+    {"PID",       0}, // product ID, 16 bit hex
+    {"FW",        2}, // firmWare, x.yy
+    {"SER#",     -1}, // serial number, string
+    {"V",         3}, // battery coltage, mV
+    {"I",         3}, // battery current, mA
+    {"VPV",       3}, // panel voltage, mV
+    {"PPV",       0}, // panel power, W
+    {"CS",        0}, // charging state
+    {"LOAD",     -1}, // load switch (ON/OFF)
+    {"IL",        3}, // load current, mA
+    {"H19",       2}, // yield total, 1/100 kWh
+    {"H20",       2}, // yield today, 1/100 kWh
+    {"H21",       0}, // maximum power today, W
+    {"HSDS",      0}, // day sequence number (0...364)
+    {"Checksum", -2}  // end of block
+};
+
+const int numFrames = 3600;  // one hour, one frame per second
+
+// archive written to memory, a file would be used the same way
+class ArchiveBuffer : public Print
+{
+public:
+    uint8_t *data = nullptr;
+    size_t len = 0;
+    size_t size = 0;
+    size_t write(uint8_t b)
+    {
+        return write(&b, 1);
+    }
+    size_t write(const uint8_t *buf, size_t n)
+    {
+        if (len + n > size)
+        { // grow buffer
+            size = 2 * (len + n);
+            data = (uint8_t *)realloc(data, size);
+        }
+        memcpy(data + len, buf, n);
+        len += n;
+        return n;
+    }
+};
+
+// block n of test data, slowly changing values as sent by charger
+String makeBlock(int n)
+{
+    String block = "\r\nPID\t0xA053\r\nFW\t163\r\nSER#\tHQ2144VVVT4";
+    block += "\r\nV\t" + String(13000 + (n * 7) % 400) + "\r\nI\t" + String(1830 - (n * 13) % 900);
+    block += "\r\nVPV\t" + String(33650 + (n * 31) % 700) + "\r\nPPV\t" + String((n / 10) % 40);
+    block += "\r\nCS\t3\r\nLOAD\t" + String((n / 600) % 2 ? "ON" : "OFF") + "\r\nIL\t0";
+    block += "\r\nH19\t" + String(2552 + n / 360) + "\r\nH20\t" + String(n / 360) + "\r\nH21\t34";
+    if (n % 100 != 50) // some blocks without day sequence
+        block += "\r\nHSDS\t50";
+    block += "\r\nChecksum\t";
+    uint8_t chksum = 0;
+    for (unsigned i=0; i<block.length(); i++)
+        chksum += block[i];
+    block += (char)(256 - chksum);
+    return block;
+}
+
+// parse block n, true if valid
+bool parseBlock(VEdirect &device, int n)
+{
+    String block = makeBlock(n);
+    size_t used;
+    return device.parse(block.c_str(), block.length(), used);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println();
+    Serial.println("=====================");
+    Serial.println("VEdirect archive test");
+
+    // write
+    VEdirect SmartSolar(SmartSolarKeys, false);
+    ArchiveBuffer buffer;
+    VEarchiveWriter writer(SmartSolarKeys, buffer);
+    size_t jsonLen = 0;
+    uint32_t t0 = micros();
+    for (int n=0; n<numFrames; n++)
+    {
+        if (parseBlock(SmartSolar, n))
+            writer.add(SmartSolar, n * 1000);
+    }
+    writer.close();
+    uint32_t t1 = micros();
+    for (int n=0; n<numFrames; n++)
+    {
+        if (parseBlock(SmartSolar, n))
+            jsonLen += SmartSolar.asJson().length();
+    }
+    Serial.println(String(numFrames) + " frames, " + String(jsonLen) + " bytes as JSON, " + String(buffer.len) + " bytes archived");
+    Serial.println("compression ratio " + String((float)jsonLen / buffer.len, 1) + ", written in " + String((t1 - t0) / 1000) + " ms");
+
+    // read back all frames and compare to data parsed again
+    VEarchiveReader reader(buffer.data, buffer.len);
+    int frames = 0;
+    bool same = true;
+    for (int n=0; n<numFrames; n++)
+    {
+        if (!parseBlock(SmartSolar, n))
+            continue;
+        same &= reader.next() && (reader.time() == (uint32_t)n * 1000);
+        for (int k=0; SmartSolarKeys[k].digits != -2; k++)
+            same &= (reader.readString(SmartSolarKeys[k].name) == SmartSolar.readString(SmartSolarKeys[k].name));
+        frames++;
+    }
+    same &= !reader.next();
+    Serial.println(String(frames) + " frames read back, " + (same ? "values identical" : "values differ"));
+
+    // decoding speed, frames only and reading values
+    const String V = "V";
+    const String I = "I";
+    const int repeat = 10;
+    t0 = micros();
+    for (int r=0; r<repeat; r++)
+    {
+        VEarchiveReader decoder(buffer.data, buffer.len);
+        while (decoder.next())
+            ;
+    }
+    t1 = micros();
+    float sum = 0;
+    for (int r=0; r<repeat; r++)
+    {
+        VEarchiveReader decoder(buffer.data, buffer.len);
+        while (decoder.next())
+            sum += decoder.readFloat(V) * decoder.readFloat(I);
+    }
+    uint32_t t2 = micros();
+    Serial.println("decoding " + String((float)repeat * buffer.len / (t1 - t0), 1) + " MB/s archive, " +
+        String((float)repeat * jsonLen / (t1 - t0), 1) + " MB/s as JSON");
+    Serial.println("decoding reading 2 fields " + String((float)repeat * numFrames / (t2 - t1), 2) + " Mframes/s");
+
+    // range queries using index of blocks
+    bool found = true;
+    t0 = micros();
+    for (int q=0; q<100; q++)
+    {
+        uint32_t time = (q * 37 % (numFrames - 1)) * 1000 + 500; // between frames
+        found &= reader.seek(time) && reader.next() && (reader.time() == time + 500);
+    }
+    t1 = micros();
+    found &= !reader.seek(numFrames * 1000); // after last frame
+    Serial.println(String("seek ") + (found ? "OK, " : "failed, ") + String((t1 - t0) / 100) + " us per query");
+    free(buffer.data);
+
+    while (1)
+        ; // stop program
+}
+
+void loop()
+{
+
+}
@@ -0,0 +1,165 @@
+// sample code analyzing a VEdirect capture split in chunks
+// parsed in parallel on both ESP32 cores, results identical to sequential parsing
+// a real capture could be mapped from flash using esp_partition_mmap()
+// NOTE for timing build with debugging output off (build_flags = -D VERBOSE=0),
+// else printing HEX messages to Serial from both cores is measured mostly
+
+#include <Arduino.h>
+#include <VEdirect.h>
+#include <VEchunks.h>
+
+// keys for SmartSolar MPPT charger, first key is used to find start of blocks
+const VEdirect::VEkey SmartSolarKeys[] = {
+    {"PID",       0}, // product ID, 16 bit hex
+    {"FW",        2}, // firmWare, x.yy
+    {"SER#",     -1}, // serial number, string
+    {"V",         3}, // battery coltage, mV
+    {"I",         3}, // battery current, mA
+    {"VPV",       3}, // panel voltage, mV
+    {"PPV",       0}, // panel power, W
+    {"CS",        0}, // charging state
+    {"H19",       2}, // yield total, 1/100 kWh
+    {"Checksum", -2}  // end of block
+};
+
+// FNV-1a hash of frame as JSON, so results could be compared without keeping all of them
+uint32_t frameHash(VEdirect &parser)
+{
+    String json = parser.asJson(false);
+    uint32_t hash = 2166136261u;
+    for (unsigned i=0; i<json.length(); i++)
+        hash = (hash ^ (uint8_t)json[i]) * 16777619u;
+    return hash;
+}
+
+// results of chunks, hash of valid frames in order
+typedef struct {
+    int numChunks;
+    uint32_t **hashes;    // [chunk][frame]
+} Results;
+
+// frame function, called for every valid frame
+void storeHash(int chunk, int frame, VEdirect &parser, void *context)
+{
+    Results *results = (Results *)context;
+    results->hashes[chunk][frame] = frameHash(parser);
+}
+
+// run function parsing chunks in one task after the other
+void runSequential(VEchunks &chunks, void *context)
+{
+    for (int k=0; k<chunks.numChunks(); k++)
+        chunks.parseChunk(k);
+}
+
+typedef struct {
+    VEchunks *chunks;
+    int chunk;
+    TaskHandle_t caller;  // task to notify when done
+} ChunkTask;
+
+void chunkTask(void *param)
+{
+    ChunkTask *task = (ChunkTask *)param;
+    task->chunks->parseChunk(task->chunk);
+    xTaskNotifyGive(task->caller);
+    vTaskDelete(nullptr);
+}
+
+// run function parsing chunks in parallel tasks on both cores
+void runOnBothCores(VEchunks &chunks, void *context)
+{
+    int numChunks = chunks.numChunks();
+    ChunkTask *tasks = new ChunkTask[numChunks];
+    for (int k=0; k<numChunks; k++)
+    {
+        tasks[k] = {&chunks, k, xTaskGetCurrentTaskHandle()};
+        xTaskCreatePinnedToCore(chunkTask, "chunk", 4096, &tasks[k], 1, nullptr, k % 2);
+    }
+    for (int k=0; k<numChunks; k++)
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY); // wait for all chunks
+    delete[] tasks;
+}
+
+// split capture, parse using run function and merge results in order
+// return number of frames written to hashes
+int analyze(const char *capture, size_t len, int numChunks, VEchunks::RunFunction run, uint32_t *hashes)
+{
+    VEchunks chunks(SmartSolarKeys, numChunks);
+    Results results = {chunks.split(capture, len), new uint32_t *[numChunks]};
+    for (int k=0; k<results.numChunks; k++)
+        results.hashes[k] = new uint32_t[chunks.maxFrames(k)];
+    int numFrames = chunks.analyze(run, storeHash, &results);
+    if (chunks.numReparsed() > 0)
+        Serial.println(String(chunks.numReparsed()) + " chunks parsed again");
+    int n = 0;
+    for (int k=0; k<results.numChunks; k++)
+    {
+        memcpy(hashes + n, results.hashes[k], chunks.numFrames(k) * sizeof(uint32_t));
+        n += chunks.numFrames(k);
+        delete[] results.hashes[k];
+    }
+    delete[] results.hashes;
+    return numFrames;
+}
+
+// maximum number of frames completed in len characters ("\r\nChecksum\tX" at least)
+int maxFrames(size_t len)
+{
+    return len / 12 + 1;
+}
+
+// test capture holding some blocks, garbage and HEX messages
+String makeCapture(int numBlocks)
+{
+    String capture = "abcd";
+    for (int n=0; n<numBlocks; n++)
+    {
+        String block = "\r\nPID\t0xA053\r\nFW\t163\r\nSER#\tHQ2144VVVT4";
+        block += "\r\nV\t" + String(13000 + n % 500) + "\r\nI\t" + String(1830 - n % 100);
+        block += "\r\nVPV\t33650\r\nPPV\t" + String(n % 40) + "\r\nCS\t3\r\nH19\t" + String(2552 + n / 100);
+        block += "\r\nChecksum\t";
+        uint8_t chksum = 0;
+        for (int i=0; i<block.length(); i++)
+            chksum += block[i];
+        block += (char)(256 - chksum);
+        if (n % 17 == 0)
+            block += ":A0102000543\n"; // asynchronous HEX message
+        capture += block;
+    }
+    return capture;
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println();
+    Serial.println("==========================");
+    Serial.println("VEdirect log analyzer test");
+
+    String capture = makeCapture(100);
+    Serial.println("capture size " + String(capture.length()));
+
+    uint32_t *expected = new uint32_t[maxFrames(capture.length())];
+    uint32_t *result = new uint32_t[maxFrames(capture.length())];
+    uint32_t t0 = millis();
+    int numExpected = analyze(capture.c_str(), capture.length(), 1, runSequential, expected);
+    uint32_t t1 = millis();
+    int numResult = analyze(capture.c_str(), capture.length(), 4, runOnBothCores, result);
+    uint32_t t2 = millis();
+
+    Serial.println("sequential " + String(t1 - t0) + " ms, chunks " + String(t2 - t1) + " ms");
+    Serial.println(String(numExpected) + " frames sequential, " + String(numResult) + " frames in chunks");
+    bool same = (numResult == numExpected) && (memcmp(result, expected, numResult * sizeof(uint32_t)) == 0);
+    Serial.println(same ? "results identical" : "results differ");
+    delete[] expected;
+    delete[] result;
+
+    while (1)
+        ; // stop program
+}
+
+void loop()
+{
+
+}
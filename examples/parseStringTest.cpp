@@ -29,6 +29,30 @@ bool VEdirectParse(VEdirect &device, const String line)
   return done;
 }
 
+// helping function for testing only
+// parse String completely, return number of valid blocks
+int VEdirectCount(VEdirect &device, const String data)
+{
+  int frames = 0;
+  for (int i=0; i<data.length(); i++)
+  {
+    if (device.parse(data[i]))
+      frames++;
+  }
+  return frames;
+}
+
+// helping function for testing only
+// append checksum line to fields of block
+String VEdirectBlock(const String fields)
+{
+  String block = fields + "\r\nChecksum\t";
+  uint8_t chksum = 0;
+  for (int i=0; i<block.length(); i++)
+    chksum += block[i];
+  return block + (char)(256 - chksum);
+}
+
 // Victron SmartSolar 75/15 MPTT charger
 void SmartSolarTest(void)
 {   
@@ -57,6 +81,13 @@ void SmartSolarTest(void)
         {"Checksum", -2}  // end of block
     };
     VEdirect SmartSolar(SmartSolarKeys, false);
+    // derived fields, integral must start at 0 with first block
+    const VEdirect::VEderived SmartSolarDerived[] = {
+        {"P",         1, VEdirect::opProduct,   "V", "I", 1}, // battery power, W
+        {"Ah",        3, VEdirect::opIntegrate, "I", "",  1}, // charge since start, Ah
+        {"",          0, VEdirect::opEnd,       "",  "",  0}  // end of list
+    };
+    SmartSolar.setDerived(SmartSolarDerived);
 
     // packet from SmartSolar 75/15 MPPT charger
     VEdirectParse(SmartSolar, "abcd"); // some garbage to be ignored
@@ -91,6 +122,10 @@ void SmartSolarTest(void)
         Serial.print("battery current (float)  = "); Serial.println(SmartSolar.readFloat("I"));
         Serial.print("MPPT tracker state (int) = "); Serial.println(SmartSolar.readInt("MPPT"));
         Serial.print("load relais (string)     = "); Serial.println(SmartSolar.readString("LOAD"));
+        Serial.print("battery power (derived)  = "); Serial.println(SmartSolar.readFloat("P"));
+        Serial.print("charge (derived)         = "); Serial.println(SmartSolar.readFloat("Ah"), 3);
+        if (SmartSolar.readFloat("Ah") != 0.0f)
+            Serial.println("ERROR: charge must be 0 after first block");
         // Serial.println(SmartSolar.asJson(false));
     }
     else
@@ -144,6 +179,42 @@ void PhoenixTest(void)
     Serial.println(PhoenixInverter.asJson(false));
 }
 
+// recovery from data corrupted or interrupted by HEX messages
+void RecoveryTest(void)
+{
+    const VEdirect::VEkey TestKeys[] = {
+        {"PID",       0}, // product ID, 16 bit hex
+        {"V",         3}, // battery coltage, mV
+        {"I",         3}, // battery current, mA
+        {"Checksum", -2}  // end of block
+    };
+
+    // checksum byte is ':', which must not start a HEX message
+    VEdirect device1(TestKeys, false);
+    String block;
+    for (int v=13000; (block.length() == 0) || (block[block.length() - 1] != ':'); v++)
+        block = VEdirectBlock("\r\nPID\t0xA053\r\nV\t" + String(v) + "\r\nI\t1830");
+    int frames = VEdirectCount(device1, block + ":A0102000543\n" + VEdirectBlock("\r\nPID\t0xA053\r\nV\t13001\r\nI\t1830"));
+    Serial.print("checksum ':' + HEX message     = "); Serial.println(frames);
+    if (frames != 2)
+        Serial.println("ERROR: 2 blocks expected");
+
+    // HEX message interrupted by text message
+    VEdirect device2(TestKeys, false);
+    frames = VEdirectCount(device2, ":A01020" + VEdirectBlock("\r\nPID\t0xA053\r\nV\t13002\r\nI\t1830"));
+    Serial.print("CR inside HEX message          = "); Serial.println(frames);
+    if (frames != 1)
+        Serial.println("ERROR: 1 block expected");
+
+    // checksum line lost, block following must be recovered
+    VEdirect device3(TestKeys, false);
+    frames = VEdirectCount(device3, "\r\nPID\t0xA053\r\nV\t13003\r\nI\t1830\r\nChecksxm\tX" +
+        VEdirectBlock("\r\nPID\t0xA053\r\nV\t13004\r\nI\t1830"));
+    Serial.print("corrupted checksum name        = "); Serial.println(frames);
+    if ((frames != 1) || (device3.readString("V") != "13004"))
+        Serial.println("ERROR: 1 block expected (V = 13004)");
+}
+
 void setup() 
 {
     Serial.begin(115200);
@@ -159,6 +230,10 @@ void setup()
     Serial.println("parsing Phoenix inverter data from string");
     PhoenixTest();
 
+    Serial.println();
+    Serial.println("parsing data corrupted or interrupted");
+    RecoveryTest();
+
     while (1)
         ; // stop program
 }
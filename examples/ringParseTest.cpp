@@ -0,0 +1,71 @@
+// sample code receiving VEdirect in a separate task on core 0
+// parsing in loop() on core 1, so slow processing does not overrun the UART
+// tested with Victron SmartSolar 75/15 MPTT charger
+
+#include <Arduino.h>
+#include <VEdirect.h>
+
+// keys for SmartSolar MPPT charger
+const VEdirect::VEkey SmartSolarKeys[] = {
+    {"PID",       0}, // product ID, 16 bit hex
+    {"FW",        2}, // firmWare, x.yy
+    {"SER#",     -1}, // serial number, string
+    {"V",         3}, // battery coltage, mV
+    {"I",         3}, // battery current, mA
+    {"VPV",       3}, // panel voltage, mV
+    {"PPV",       0}, // panel power, W
+    {"CS",        0}, // charging state
+    {"MPPT",      0}, // MPPT tracker state
+    {"OR",        0}, // off reason, 32 bit hex
+    {"ERR",       0}, // error code
+    {"LOAD",     -1}, // load switch (ON/OFF)
+    {"IL",        3}, // load current, mA
+    {"H19",       2}, // yield total, 1/100 kWh
+    {"H20",       2}, // yield today, 1/100 kWh
+    {"H21",       0}, // maximum power today, W
+    {"H22",       2}, // yield yesterday, 1/100 kWh
+    {"H23",       0}, // maximum power yesterday, W
+    {"HSDS",      0}, // day sequence number (0...364)
+    {"Checksum", -2}  // end of block
+};
+
+// parser object and buffer between receive task and parser
+VEdirect SmartSolar(SmartSolarKeys, false);
+VEring SmartSolarRing(2048); // about 1 s of data at 19200 baud
+
+// producer: copy characters received to ring buffer as soon as available
+void receiveTask(void *param)
+{
+    while (1)
+    {
+        SmartSolarRing.write(Serial2, millis());
+        vTaskDelay(1); // UART FIFO holds 128 characters, about 66 ms at 19200 baud
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println();
+    Serial.println("=============================");
+    Serial.println("VEdirect test with ring buffer");
+    Serial.println();
+
+    Serial2.begin(19200); // VEdirect device
+    xTaskCreatePinnedToCore(receiveTask, "receive", 2048, nullptr, 2, nullptr, 0);
+}
+
+void loop()
+{
+    // consumer: parse characters received
+    if (SmartSolar.parse(SmartSolarRing))
+    {
+        Serial.println("");
+        Serial.print("block received at (ms)   = "); Serial.println(SmartSolarRing.timestamp());
+        Serial.print("characters dropped       = "); Serial.println(SmartSolarRing.numOverruns());
+        Serial.print("timestamps lost          = "); Serial.println(SmartSolarRing.numLostTimes());
+        Serial.print("PV voltage (float)       = "); Serial.println(SmartSolar.readFloat("VPV"));
+        Serial.print("battery current (float)  = "); Serial.println(SmartSolar.readFloat("I"));
+        delay(500); // some slow processing
+    }
+}
@@ -0,0 +1,130 @@
+// sample code publishing valid blocks to a snapshot record read by another task
+// readers just need VEsnapshot.h, so the same code could run in another process
+// reading the record from shared memory on a host
+
+#include <Arduino.h>
+#include <VEdirect.h>
+
+// keys for SmartSolar MPPT charger (part of)
+const VEdirect::VEkey SmartSolarKeys[] = {
+    {"PID",       0}, // product ID, 16 bit hex
+    {"V",         3}, // battery coltage, mV
+    {"I",         3}, // battery current, mA
+    {"Checksum", -2}  // end of block
+};
+
+// derived fields added later, changing layout of snapshot
+const VEdirect::VEderived SmartSolarDerived[] = {
+    {"P",         1, VEdirect::opProduct, "V", "I", 1}, // battery power, W
+    {"",          0, VEdirect::opEnd,     "",  "",  0}  // end of list
+};
+
+VEdirect SmartSolar(SmartSolarKeys, false);
+VEsnapshot snapshot; // could be placed in shared memory
+volatile uint32_t numReads = 0;
+volatile uint32_t numErrors = 0;
+
+// block with checksum, current always V - 10000 so readers could check consistency
+String makeBlock(int v)
+{
+    String block = "\r\nPID\t0xA053\r\nV\t" + String(v) + "\r\nI\t" + String(v - 10000) + "\r\nChecksum\t";
+    uint8_t chksum = 0;
+    for (unsigned i=0; i<block.length(); i++)
+        chksum += block[i];
+    return block + (char)(256 - chksum);
+}
+
+void parseBlock(int v)
+{
+    String block = makeBlock(v);
+    size_t used;
+    SmartSolar.parse(block.c_str(), block.length(), used);
+}
+
+// reader in other task, reading voltage and current of same block
+void readerTask(void *param)
+{
+    VEsnapshotRef V = VEsnapshotFind(&snapshot, "V");
+    VEsnapshotRef I = VEsnapshotFind(&snapshot, "I");
+    while (1)
+    {
+        uint32_t seq;
+        float voltage, current;
+        bool ok = true;
+        do {
+            if (!VEsnapshotBegin(&snapshot, seq))
+            {
+                ok = false; // writer not responding
+                break;
+            }
+            if (!VEsnapshotCurrent(&snapshot, V) || !VEsnapshotCurrent(&snapshot, I))
+            { // layout changed, find fields again
+                V = VEsnapshotFind(&snapshot, "V");
+                I = VEsnapshotFind(&snapshot, "I");
+                ok = false;
+                break;
+            }
+            voltage = snapshot.fields[V.index].number;
+            current = snapshot.fields[I.index].number;
+        } while (VEsnapshotRetry(&snapshot, seq));
+        if (ok)
+        {
+            numReads++;
+            if (lroundf(1000 * (voltage - current)) != 10000)
+                numErrors++; // values of different blocks
+        }
+        vTaskDelay(1);
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println();
+    Serial.println("======================");
+    Serial.println("VEdirect snapshot test");
+
+    SmartSolar.setSnapshot(&snapshot);
+    parseBlock(13260);
+
+    // find and read fields
+    VEsnapshotRef V = VEsnapshotFind(&snapshot, "V");
+    VEsnapshotRef PID = VEsnapshotFind(&snapshot, "PID");
+    float voltage = 0;
+    char text[VESNAPSHOT_TEXT];
+    bool ok = VEsnapshotReadFloat(&snapshot, V, voltage) && (lroundf(1000 * voltage) == 13260);
+    ok &= VEsnapshotReadText(&snapshot, PID, text, sizeof(text)) && (strcmp(text, "0xA053") == 0);
+    ok &= (VEsnapshotFind(&snapshot, "XYZ").index < 0);
+    Serial.println(String("read fields:           ") + (ok ? "OK" : "ERROR"));
+
+    // derived fields change layout, references found before are not valid any more
+    SmartSolar.setDerived(SmartSolarDerived);
+    ok = !VEsnapshotReadFloat(&snapshot, V, voltage) && !VEsnapshotCurrent(&snapshot, V);
+    V = VEsnapshotFind(&snapshot, "V");
+    VEsnapshotRef P = VEsnapshotFind(&snapshot, "P");
+    parseBlock(13270);
+    float power = 0;
+    ok &= VEsnapshotReadFloat(&snapshot, V, voltage) && (lroundf(1000 * voltage) == 13270);
+    ok &= VEsnapshotReadFloat(&snapshot, P, power) && (lroundf(10 * power) == 434); // 13.27 V * 3.27 A
+    Serial.println(String("layout changed:        ") + (ok ? "OK" : "ERROR"));
+
+    // writer died while updating (sequence left odd), readers must not hang
+    snapshot.sequence++;
+    uint32_t t0 = micros();
+    ok = !VEsnapshotReadFloat(&snapshot, V, voltage) && (VEsnapshotFind(&snapshot, "V").index < 0);
+    uint32_t t1 = micros();
+    snapshot.sequence++;
+    ok &= VEsnapshotReadFloat(&snapshot, V, voltage);
+    Serial.println(String("writer not responding: ") + (ok ? "OK" : "ERROR") + ", gave up after " + String(t1 - t0) + " us");
+
+    // reader on core 0, parser in loop() on core 1
+    xTaskCreatePinnedToCore(readerTask, "reader", 2048, nullptr, 1, nullptr, 0);
+}
+
+void loop()
+{
+    for (int v=13000; v<13500; v++)
+        parseBlock(v);
+    Serial.println("reads " + String(numReads) + ", inconsistent " + String(numErrors));
+    delay(1000);
+}
@@ -0,0 +1,726 @@
+#include "VEarchive.h"
+
+#define HEADER_SIZE 16 // "VEA1" (or "VEX1"), payload length, time of first and last frame
+
+enum {cellMissing, cellInt, cellText};    // kind of value stored in cell
+enum {modeEmpty, modeInt, modeText};      // encoding of column
+
+// in place, values as first, first delta, then delta of delta (undone by getRuns() while decoding)
+// calculated unsigned, so corrupted data just wraps around
+static void deltaOfDelta(int64_t *v, int n)
+{
+    uint64_t *u = (uint64_t *)v;
+    for (int i=n-1; i>=2; i--)
+        u[i] = (u[i] - u[i-1]) - (u[i-1] - u[i-2]);
+    if (n >= 2)
+        u[1] = u[1] - u[0];
+}
+
+
+// ========== writer ==========
+
+VEarchiveWriter::VEarchiveWriter(const VEdirect::VEkey *VEkeys, Print &output, int framesPerBlock) :
+    out(output),
+    keys(VEkeys),
+    maxFrames(framesPerBlock),
+    numFrames(0),
+    bufLen(0),
+    bufSize(256),
+    written(0),
+    numBlocks(0),
+    maxBlocks(16),
+    lastTime(0)
+{
+    for (numKeys = 0; keys[numKeys].digits != -2; numKeys++)
+        ; // count keys up to end of block marker
+    times = new uint32_t[maxFrames];
+    cells = new int32_t[numKeys * maxFrames];
+    kinds = new uint8_t[numKeys * maxFrames];
+    dict = new String[numKeys * maxFrames];
+    dictSize = new int[numKeys];
+    temp = new int64_t[maxFrames];
+    buf = new uint8_t[bufSize];
+    blockTimes = new uint32_t[maxBlocks];
+    blockPos = new uint32_t[maxBlocks];
+    for (int k=0; k<numKeys; k++)
+        dictSize[k] = 0;
+}
+
+VEarchiveWriter::~VEarchiveWriter()
+{
+    delete[] times;
+    delete[] cells;
+    delete[] kinds;
+    delete[] dict;
+    delete[] dictSize;
+    delete[] temp;
+    delete[] buf;
+    delete[] blockTimes;
+    delete[] blockPos;
+}
+
+// values just holding decimal digits in int32 range are stored as integers, anything else (e.g. hex) as string
+void VEarchiveWriter::add(VEdirect &device, uint32_t time)
+{
+    times[numFrames] = time;
+    for (int k=0; k<numKeys; k++)
+    {
+        int cell = k * maxFrames + numFrames;
+        String value = device.readString(keys[k].name);
+        long number = value.toInt(); // long might be 64 bit (e.g. on host)
+        if (value.length() == 0)
+            kinds[cell] = cellMissing;
+        else if ((keys[k].digits >= 0) && (number >= INT32_MIN) && (number <= INT32_MAX) && (value == String(number)))
+        {
+            kinds[cell] = cellInt;
+            cells[cell] = number;
+        }
+        else
+        {
+            kinds[cell] = cellText;
+            cells[cell] = dictIndex(k, value);
+        }
+    }
+    if (++numFrames >= maxFrames)
+        flush();
+}
+
+void VEarchiveWriter::flush()
+{
+    if (numFrames == 0)
+        return;
+    bufLen = 0;
+    putVarint(numFrames);
+    for (int i=0; i<numFrames; i++)
+        temp[i] = times[i];
+    deltaOfDelta(temp, numFrames);
+    putRuns(temp, numFrames);
+    putVarint(numKeys);
+    for (int k=0; k<numKeys; k++)
+        putColumn(k);
+
+    if (numBlocks >= maxBlocks)
+    { // grow index
+        uint32_t *largerTimes = new uint32_t[2 * maxBlocks];
+        uint32_t *largerPos = new uint32_t[2 * maxBlocks];
+        memcpy(largerTimes, blockTimes, numBlocks * sizeof(uint32_t));
+        memcpy(largerPos, blockPos, numBlocks * sizeof(uint32_t));
+        delete[] blockTimes;
+        delete[] blockPos;
+        blockTimes = largerTimes;
+        blockPos = largerPos;
+        maxBlocks *= 2;
+    }
+    blockTimes[numBlocks] = times[0];
+    blockPos[numBlocks++] = written;
+    lastTime = times[numFrames-1];
+
+    out.write((const uint8_t *)"VEA1", 4);
+    putU32(bufLen);
+    putU32(times[0]);
+    putU32(times[numFrames-1]);
+    out.write(buf, bufLen);
+    written += HEADER_SIZE + bufLen;
+
+    numFrames = 0; // start new block
+    for (int k=0; k<numKeys; k++)
+        dictSize[k] = 0;
+}
+
+// index holds blocks written since last close(), so archive files could be appended
+// distances are relative to index, so they are valid wherever the file starts
+void VEarchiveWriter::close()
+{
+    flush();
+    if (numBlocks == 0)
+        return;
+    uint32_t payload = 8 * numBlocks + 4;
+    out.write((const uint8_t *)"VEX1", 4);
+    putU32(payload);
+    putU32(blockTimes[0]);
+    putU32(lastTime);
+    for (int i=0; i<numBlocks; i++)
+    {
+        putU32(blockTimes[i]);
+        putU32(written - blockPos[i]);
+    }
+    putU32(HEADER_SIZE + payload);
+    written += HEADER_SIZE + payload;
+    numBlocks = 0; // start new index
+}
+
+void VEarchiveWriter::putU32(uint32_t v)
+{
+    for (int b=0; b<4; b++)
+        out.write((uint8_t)(v >> (8 * b))); // little endian
+}
+
+// dictionary of strings is valid for one block only
+int VEarchiveWriter::dictIndex(int key, const String &value)
+{
+    String *d = dict + key * maxFrames;
+    for (int i=0; i<dictSize[key]; i++)
+    {
+        if (d[i] == value)
+            return i;
+    }
+    d[dictSize[key]] = value; // at most one new entry per frame, so always space left
+    return dictSize[key]++;
+}
+
+void VEarchiveWriter::putColumn(int key)
+{
+    int base = key * maxFrames;
+    bool anyValue = false;
+    bool allInt = true;
+    for (int i=0; i<numFrames; i++)
+    {
+        anyValue |= (kinds[base + i] != cellMissing);
+        allInt &= (kinds[base + i] != cellText);
+    }
+    putString(keys[key].name);
+    putSigned(keys[key].digits);
+    uint8_t mode = !anyValue ? modeEmpty : (allInt ? modeInt : modeText);
+    put(mode);
+    if (mode == modeEmpty)
+        return;
+
+    // presence as alternating run lengths, starting with values present
+    bool present = true;
+    uint32_t run = 0;
+    for (int i=0; i<numFrames; i++)
+    {
+        if ((kinds[base + i] != cellMissing) == present)
+            run++;
+        else
+        {
+            putVarint(run);
+            present = !present;
+            run = 1;
+        }
+    }
+    putVarint(run);
+
+    int n = 0;
+    if (mode == modeInt)
+    { // smooth or constant values result in runs of small numbers
+        for (int i=0; i<numFrames; i++)
+            if (kinds[base + i] != cellMissing)
+                temp[n++] = cells[base + i];
+        deltaOfDelta(temp, n);
+    }
+    else
+    {
+        for (int i=0; i<numFrames; i++)
+        {
+            if (kinds[base + i] == cellInt) // mixed column, all stored as string
+                cells[base + i] = dictIndex(key, String(cells[base + i]));
+            if (kinds[base + i] != cellMissing)
+                temp[n++] = cells[base + i];
+        }
+        putVarint(dictSize[key]);
+        for (int i=0; i<dictSize[key]; i++)
+            putString(dict[base + i]);
+    }
+    putRuns(temp, n);
+}
+
+void VEarchiveWriter::put(uint8_t b)
+{
+    if (bufLen >= bufSize)
+    { // grow buffer
+        uint8_t *larger = new uint8_t[2 * bufSize];
+        memcpy(larger, buf, bufLen);
+        delete[] buf;
+        buf = larger;
+        bufSize *= 2;
+    }
+    buf[bufLen++] = b;
+}
+
+void VEarchiveWriter::putVarint(uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        put((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    put((uint8_t)v);
+}
+
+void VEarchiveWriter::putSigned(int64_t v)
+{
+    putVarint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); // zigzag
+}
+
+void VEarchiveWriter::putString(const String &s)
+{
+    putVarint(s.length());
+    for (unsigned i=0; i<s.length(); i++)
+        put(s[i]);
+}
+
+// value zigzag encoded and shifted left, bit 0 set if followed by run length - 2
+void VEarchiveWriter::putRuns(const int64_t *v, int n)
+{
+    for (int i=0; i<n; )
+    {
+        int run = 1;
+        while ((i + run < n) && (v[i + run] == v[i]))
+            run++;
+        uint64_t zigzag = ((uint64_t)v[i] << 1) ^ (uint64_t)(v[i] >> 63);
+        putVarint((zigzag << 1) | (run > 1 ? 1 : 0));
+        if (run > 1)
+            putVarint(run - 2);
+        i += run;
+    }
+}
+
+// ========== reader ==========
+
+// position while decoding a block, ok cleared on any error
+typedef struct {const uint8_t *p; const uint8_t *end; bool ok;} Cursor;
+
+static uint64_t getVarint(Cursor &c)
+{
+    if ((c.p < c.end) && (*c.p < 0x80))
+        return *c.p++; // single byte, most values in blocks
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (c.p >= c.end)
+            break;
+        uint8_t b = *c.p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            return v;
+    }
+    c.ok = false;
+    return 0;
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// strings are not copied while decoding, just referenced in archive
+static VEarchiveReader::View getView(Cursor &c)
+{
+    VEarchiveReader::View v = {(const char *)c.p, 0};
+    uint64_t len = getVarint(c);
+    if (len > (uint64_t)(c.end - c.p))
+    {
+        c.ok = false;
+        return v;
+    }
+    v.text = (const char *)c.p;
+    v.len = len;
+    c.p += len;
+    return v;
+}
+
+static String toString(VEarchiveReader::View v)
+{
+    String s;
+    s.concat(v.text, v.len);
+    return s;
+}
+
+// same as String::toInt() (base 10) or hex, without allocating memory
+static long toInt(VEarchiveReader::View v, int base)
+{
+    char text[24];
+    size_t len = (v.len < sizeof(text)) ? v.len : sizeof(text) - 1;
+    memcpy(text, v.text, len);
+    text[len] = 0;
+    return strtol(text, nullptr, base);
+}
+
+static uint32_t getU32(const uint8_t *p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); // little endian
+}
+
+// run length decoding, delta of delta undone in same pass if integrate is set
+static void getRuns(Cursor &c, int64_t *v, int n, bool integrate)
+{
+    uint64_t value = 0; // unsigned, so corrupted data just wraps around
+    uint64_t delta = 0;
+    for (int i=0; (i < n) && c.ok; )
+    {
+        uint64_t token = getVarint(c);
+        uint64_t run = (token & 1) ? getVarint(c) + 2 : 1;
+        if (run > (uint64_t)(n - i))
+        {
+            c.ok = false;
+            return;
+        }
+        uint64_t x = unzigzag(token >> 1);
+        int end = i + run;
+        if (!integrate)
+        {
+            for (; i<end; i++)
+                v[i] = x;
+            continue;
+        }
+        if (i == 0)
+            v[i++] = value = x; // first value as is, first delta follows
+        for (; i<end; i++)
+        {
+            delta += x;
+            value += delta;
+            v[i] = value;
+        }
+    }
+}
+
+VEarchiveReader::VEarchiveReader(const uint8_t *data, size_t len) :
+    archive(data),
+    archiveLen(len),
+    nextBlock(0),
+    numFrames(0),
+    frame(-1),
+    numColumns(0),
+    maxFrames(0),
+    maxColumns(0),
+    times(nullptr),
+    cells(nullptr),
+    kinds(nullptr),
+    temp(nullptr),
+    names(nullptr),
+    digits(nullptr),
+    dict(nullptr),
+    dictStart(nullptr),
+    cachedColumn(-1),
+    indexLoaded(false),
+    numBlocks(0),
+    index(nullptr),
+    indexPos(0),
+    scanned(nullptr)
+{
+}
+
+VEarchiveReader::~VEarchiveReader()
+{
+    delete[] times;
+    delete[] cells;
+    delete[] kinds;
+    delete[] temp;
+    delete[] names;
+    delete[] digits;
+    delete[] dict;
+    delete[] dictStart;
+    delete[] scanned;
+}
+
+bool VEarchiveReader::blockHeader(size_t pos, size_t &payload, uint32_t &first, uint32_t &last, const char *magic)
+{
+    if ((pos > archiveLen) || (archiveLen - pos < HEADER_SIZE) || (memcmp(archive + pos, magic, 4) != 0))
+        return false;
+    payload = getU32(archive + pos + 4);
+    first = getU32(archive + pos + 8);
+    last = getU32(archive + pos + 12);
+    return payload <= archiveLen - pos - HEADER_SIZE;
+}
+
+// index at end of archive is used if it covers all blocks, else (e.g. archive not closed
+// or several archives appended) block headers are walked once and positions kept
+void VEarchiveReader::loadIndex()
+{
+    indexLoaded = true;
+    size_t payload;
+    uint32_t first, last;
+    if (archiveLen >= HEADER_SIZE + 4)
+    {
+        uint32_t len = getU32(archive + archiveLen - 4);
+        indexPos = (len <= archiveLen) ? archiveLen - len : archiveLen;
+        if (blockHeader(indexPos, payload, first, last, "VEX1") &&
+            (payload + HEADER_SIZE == len) && (payload % 8 == 4) && (payload >= 12))
+        {
+            index = archive + indexPos + HEADER_SIZE;
+            numBlocks = payload / 8;
+            if (getU32(index + 4) == indexPos)
+                return; // first block at start of archive
+            index = nullptr;
+        }
+    }
+    int maxBlocks = 0;
+    numBlocks = 0;
+    for (size_t pos = 0; pos < archiveLen; pos += HEADER_SIZE + payload)
+    {
+        if (blockHeader(pos, payload, first, last, "VEX1"))
+            continue; // index of appended archive
+        if (!blockHeader(pos, payload, first, last))
+            break;
+        if (numBlocks >= maxBlocks)
+        { // grow list of positions
+            maxBlocks = (maxBlocks == 0) ? 64 : 2 * maxBlocks;
+            size_t *larger = new size_t[maxBlocks];
+            if (numBlocks > 0)
+                memcpy(larger, scanned, numBlocks * sizeof(size_t));
+            delete[] scanned;
+            scanned = larger;
+        }
+        scanned[numBlocks++] = pos;
+    }
+}
+
+size_t VEarchiveReader::blockAt(int i)
+{
+    if (index == nullptr)
+        return scanned[i];
+    uint32_t distance = getU32(index + 8 * i + 4);
+    return (distance <= indexPos) ? indexPos - distance : archiveLen; // not valid if out of range
+}
+
+uint32_t VEarchiveReader::blockTime(int i)
+{
+    if (index != nullptr)
+        return getU32(index + 8 * i);
+    size_t payload;
+    uint32_t first, last;
+    blockHeader(scanned[i], payload, first, last);
+    return first;
+}
+
+bool VEarchiveReader::decodeBlock(size_t pos)
+{
+    size_t payload;
+    uint32_t first, last;
+    numFrames = 0;
+    frame = -1;
+    cachedColumn = -1; // columns might be different in this block
+    if (!blockHeader(pos, payload, first, last))
+        return false;
+    nextBlock = pos + HEADER_SIZE + payload;
+    Cursor c = {archive + pos + HEADER_SIZE, archive + nextBlock, true};
+
+    uint64_t n = getVarint(c);
+    if (!c.ok || (n == 0) || (n > payload))
+        return false; // every frame takes at least one byte
+    if ((int)n > maxFrames)
+    { // allocate larger buffers
+        maxFrames = n;
+        maxColumns = 0; // force reallocation of column buffers
+        delete[] times;
+        delete[] temp;
+        times = new uint32_t[maxFrames];
+        temp = new int64_t[maxFrames];
+    }
+    getRuns(c, temp, n, true);
+    for (uint64_t i=0; i<n; i++)
+        times[i] = temp[i];
+
+    uint64_t cols = getVarint(c);
+    if (!c.ok || (cols > payload))
+        return false;
+    if ((int)cols > maxColumns)
+    {
+        maxColumns = cols;
+        delete[] cells;
+        delete[] kinds;
+        delete[] names;
+        delete[] digits;
+        delete[] dict;
+        delete[] dictStart;
+        cells = new int32_t[maxColumns * maxFrames];
+        kinds = new uint8_t[maxColumns * maxFrames];
+        names = new View[maxColumns];
+        digits = new int[maxColumns];
+        dict = new View[maxColumns * maxFrames];
+        dictStart = new int[maxColumns];
+    }
+    numColumns = cols;
+    int dictLen = 0;
+    for (int col=0; (col < numColumns) && c.ok; col++)
+    {
+        int base = col * maxFrames;
+        names[col] = getView(c);
+        digits[col] = unzigzag(getVarint(c));
+        uint8_t mode = (c.p < c.end) ? *c.p++ : modeEmpty;
+        dictStart[col] = dictLen;
+        if (mode == modeEmpty)
+        {
+            memset(kinds + base, cellMissing, n);
+            continue;
+        }
+        if (mode > modeText)
+            return false;
+
+        bool present = true;
+        int m = 0; // number of values present
+        uint8_t kind = (mode == modeInt) ? cellInt : cellText;
+        for (uint64_t i=0; (i < n) && c.ok; present = !present)
+        {
+            uint64_t run = getVarint(c);
+            if (run > n - i)
+                return false;
+            memset(kinds + base + i, present ? kind : cellMissing, run);
+            if (present)
+                m += run;
+            i += run;
+        }
+        int entries = 0;
+        if (mode == modeText)
+        {
+            uint64_t size = getVarint(c);
+            if (size > n)
+                return false; // at most one entry per frame
+            for (entries = 0; (entries < (int)size) && c.ok; entries++)
+                dict[dictLen++] = getView(c);
+        }
+        getRuns(c, temp, m, mode == modeInt);
+        if ((mode == modeInt) && (m == (int)n))
+        { // all values present, most columns
+            for (uint64_t i=0; i<n; i++)
+                cells[base + i] = temp[i];
+            continue;
+        }
+        int v = 0;
+        for (uint64_t i=0; i<n; i++)
+        {
+            if (kinds[base + i] == cellMissing)
+                continue;
+            if ((mode == modeText) && ((temp[v] < 0) || (temp[v] >= entries)))
+                return false; // index not in dictionary
+            cells[base + i] = temp[v++];
+        }
+    }
+    if (!c.ok)
+        return false;
+    numFrames = n;
+    return true;
+}
+
+// binary search in index for last block starting at or before time,
+// following blocks just checked by header if that one ends before time
+bool VEarchiveReader::seek(uint32_t t)
+{
+    if (!indexLoaded)
+        loadIndex();
+    int low = 0;
+    int high = numBlocks; // first block starting after time
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (blockTime(mid) <= t)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    size_t payload;
+    uint32_t first, last;
+    for (int i = (low > 0) ? low - 1 : 0; (i < numBlocks) && blockHeader(blockAt(i), payload, first, last); i++)
+    {
+        if (last >= t)
+        {
+            if (!decodeBlock(blockAt(i)))
+                break;
+            for (frame = 0; (frame < numFrames) && (times[frame] < t); frame++)
+                ; // find first frame in range
+            frame--; // returned by next()
+            return true;
+        }
+    }
+    numFrames = 0; // nothing in range, next() must not return any frame
+    frame = -1;
+    nextBlock = archiveLen;
+    return false;
+}
+
+bool VEarchiveReader::next()
+{
+    if (frame + 1 < numFrames)
+    {
+        frame++;
+        return true;
+    }
+    size_t payload;
+    uint32_t first, last;
+    if (blockHeader(nextBlock, payload, first, last, "VEX1"))
+        nextBlock += HEADER_SIZE + payload; // skip index, another archive might be appended
+    if ((nextBlock >= archiveLen) || !decodeBlock(nextBlock))
+        return false;
+    frame = 0;
+    return true;
+}
+
+uint32_t VEarchiveReader::time()
+{
+    if ((frame < 0) || (frame >= numFrames))
+        return 0;
+    return times[frame];
+}
+
+// return same codes as VEdirect
+// -3 = value empty
+// -2 = name not available
+// -1 = no frame
+//  0... column index
+int VEarchiveReader::hasField(const String &name)
+{
+    if ((frame < 0) || (frame >= numFrames))
+        return -1;
+    int col = findColumn(name);
+    if (col < 0)
+        return -2;
+    return (kinds[col * maxFrames + frame] == cellMissing) ? -3 : col;
+}
+
+// typically the same fields are read in column order for every frame,
+// so search starts at last one found, no copy of name kept
+int VEarchiveReader::findColumn(const String &name)
+{
+    int start = (cachedColumn >= 0) ? cachedColumn : 0;
+    for (int n=0; n<numColumns; n++)
+    {
+        int col = (start + n) % numColumns;
+        if ((names[col].len == name.length()) && (memcmp(names[col].text, name.c_str(), names[col].len) == 0))
+        {
+            cachedColumn = col;
+            return col;
+        }
+    }
+    return -1;
+}
+
+String VEarchiveReader::readString(const String &name)
+{
+    int col = hasField(name);
+    if (col < 0)
+        return "";
+    int cell = col * maxFrames + frame;
+    if (kinds[cell] == cellInt)
+        return String(cells[cell]);
+    return toString(dict[dictStart[col] + cells[cell]]);
+}
+
+int VEarchiveReader::readInt(const String &name)
+{
+    int col = hasField(name);
+    if ((col < 0) || (digits[col] != 0))
+        return 0;
+    int cell = col * maxFrames + frame;
+    if (kinds[cell] == cellInt)
+        return cells[cell];
+    View value = dict[dictStart[col] + cells[cell]];
+    if ((value.len > 2) && (memcmp(value.text, "0x", 2) == 0))
+        return toInt({value.text + 2, value.len - 2}, 16);
+    else
+        return toInt(value, 10);
+}
+
+float VEarchiveReader::readFloat(const String &name)
+{
+    int col = hasField(name);
+    if ((col < 0) || (digits[col] < 0))
+        return NAN;
+    int cell = col * maxFrames + frame;
+    float value = (kinds[cell] == cellInt) ? cells[cell] : toInt(dict[dictStart[col] + cells[cell]], 10); // read raw as int
+    for (int i=0; i<digits[col]; i++)
+    {
+        value /= 10.0f; // respect number of decimals
+    }
+    return value;
+}
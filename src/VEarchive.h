@@ -0,0 +1,112 @@
+#ifndef _VEARCHIVE_H_
+#define _VEARCHIVE_H_
+
+#include <Arduino.h>
+#include "VEdirect.h"
+
+// compressed archive of valid blocks, stored in blocks of frames holding one column per key
+// each block starts with a header, so reader could skip blocks not in time range:
+//   "VEA1", payload length, time of first and last frame (uint32 each, little endian)
+// payload (all numbers as varint):
+//   number of frames, times as delta of delta
+//   number of columns, per column name, digits and mode
+//     presence of values as run lengths
+//     integers (int32) as delta of delta, strings as dictionary index, both run length encoded
+// close() appends an index of blocks, so reader could find time range by binary search:
+//   "VEX1", payload length, time of first and last frame (uint32 each, little endian)
+// payload (uint32, little endian):
+//   per block time of first frame and distance from start of block to start of index
+//   length of index including header, last 4 bytes of archive
+
+class VEarchiveWriter
+{
+public:
+    // record keys listed, "Checksum" marks end of list
+    VEarchiveWriter(const VEdirect::VEkey *VEkeys, Print &output, int framesPerBlock=60);
+    ~VEarchiveWriter();                        // NOTE frames not flushed are lost, index not written
+    VEarchiveWriter(const VEarchiveWriter &) = delete;
+    VEarchiveWriter &operator=(const VEarchiveWriter &) = delete;
+    void add(VEdirect &device, uint32_t time); // record current data of device, e.g. on valid block
+    void flush();                              // write frames not written yet, e.g. before closing file
+    void close();                              // write frames not written yet and index of blocks
+private:
+    Print &out;                           // stream to write blocks to
+    const VEdirect::VEkey *keys;          // pointer to key names/digits
+    int numKeys;                          // number of columns
+    int maxFrames;                        // frames per block
+    int numFrames;                        // frames in current block
+    uint32_t *times;                      // time of frames
+    int32_t *cells;                       // integer value or dictionary index [key * maxFrames + frame]
+    uint8_t *kinds;                       // cellMissing, cellInt or cellText
+    String *dict;                         // distinct strings of current block [key * maxFrames + index]
+    int *dictSize;                        // number of dictionary entries per key
+    int64_t *temp;                        // values of one column while encoding
+    uint8_t *buf;                         // encoded block
+    size_t bufLen;
+    size_t bufSize;
+    size_t written;                       // bytes written to stream
+    uint32_t *blockTimes;                 // index, time of first frame of blocks written
+    uint32_t *blockPos;                   // index, position of blocks written
+    int numBlocks;                        // blocks in index
+    int maxBlocks;                        // size of index allocated
+    uint32_t lastTime;                    // time of last frame written
+    void putU32(uint32_t v);              // write little endian to stream
+    int dictIndex(int key, const String &value); // find or add dictionary entry
+    void put(uint8_t b);                  // append byte to encoded block
+    void putVarint(uint64_t v);
+    void putSigned(int64_t v);            // zigzag encoded varint
+    void putString(const String &s);      // length + characters
+    void putRuns(const int64_t *v, int n);// run length encoded signed values
+    void putColumn(int key);
+};
+
+class VEarchiveReader
+{
+public:
+    // archive in memory (e.g. file mapped or read to buffer)
+    VEarchiveReader(const uint8_t *data, size_t len);
+    ~VEarchiveReader();
+    VEarchiveReader(const VEarchiveReader &) = delete;
+    VEarchiveReader &operator=(const VEarchiveReader &) = delete;
+    bool seek(uint32_t time);             // next() will return first frame at or after time, false if none
+    bool next();                          // go to next frame, false at end of archive or data not valid
+    uint32_t time();                      // time of current frame
+    // access to data of current frame, same as VEdirect
+    int hasField(const String &name);     // return column index if value available
+    String readString(const String &name);// read any value as string (raw format for floats)
+    int readInt(const String &name);      // read value as int, 0 if not valid
+    float readFloat(const String &name);  // read value as float, NAN if not valid
+    typedef struct {const char *text; size_t len;} View; // string in archive, not terminated
+private:
+    const uint8_t *archive;               // archive data
+    size_t archiveLen;
+    size_t nextBlock;                     // position of next block header
+    int numFrames;                        // frames in current block
+    int frame;                            // current frame, -1 before first
+    int numColumns;                       // columns in current block
+    int maxFrames;                        // size of buffers allocated
+    int maxColumns;
+    uint32_t *times;
+    int32_t *cells;                       // [column * maxFrames + frame]
+    uint8_t *kinds;
+    int64_t *temp;                        // values of one column while decoding
+    View *names;                          // column names
+    int *digits;                          // column digits
+    View *dict;                           // dictionary, all columns
+    int *dictStart;                       // first dictionary entry of column
+    int cachedColumn;                     // last column found, -1 if not valid
+    int findColumn(const String &name);   // column index, -1 if not found
+    bool decodeBlock(size_t pos);         // decode block, false if not valid
+    bool blockHeader(size_t pos, size_t &payload, uint32_t &first, uint32_t &last, const char *magic="VEA1");
+    // index of blocks, written by close() or found by walking headers once
+    bool indexLoaded;
+    int numBlocks;
+    const uint8_t *index;                 // entries of index in archive, nullptr if not available
+    size_t indexPos;                      // position of index in archive
+    size_t *scanned;                      // position of blocks found if index not available
+    void loadIndex();
+    size_t blockAt(int i);                // position of block
+    uint32_t blockTime(int i);            // time of first frame of block
+};
+
+#endif
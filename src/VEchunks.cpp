@@ -0,0 +1,126 @@
+#include "VEchunks.h"
+
+VEchunks::VEchunks(const VEdirect::VEkey *VEkeys, int maxChunks) :
+    keys(VEkeys),
+    maxNum(maxChunks > 0 ? maxChunks : 1),
+    num(0),
+    reparsed(0),
+    frameFunction(nullptr),
+    frameContext(nullptr)
+{
+    chunks = new Chunk[maxNum];
+    for (int k=0; k<maxNum; k++)
+    {
+        chunks[k].buf = nullptr;
+        chunks[k].len = 0;
+        chunks[k].parser = nullptr;
+        chunks[k].numFrames = 0;
+    }
+}
+
+VEchunks::~VEchunks()
+{
+    for (int k=0; k<maxNum; k++)
+        delete chunks[k].parser;
+    delete[] chunks;
+}
+
+// chunks of about same size, each one (except first) starting at a sync point
+// chunks might be empty if capture is small, new parsers for every split
+int VEchunks::split(const char *capture, size_t len)
+{
+    size_t start = 0;
+    for (int k=0; k<maxNum; k++)
+    {
+        delete chunks[k].parser;
+        chunks[k].parser = new VEdirect(keys, false);
+        size_t target = len * (k + 1) / maxNum;
+        if (target < start)
+            target = start;
+        size_t end = (k == maxNum - 1) ? len : target + chunks[k].parser->findSync(capture + target, len - target);
+        chunks[k].buf = capture + start;
+        chunks[k].len = end - start;
+        chunks[k].numFrames = 0;
+        start = end;
+    }
+    num = maxNum;
+    return num;
+}
+
+int VEchunks::numChunks()
+{
+    return num;
+}
+
+// every frame takes "\r\nChecksum\tX" at least
+int VEchunks::maxFrames(int chunk)
+{
+    if ((chunk < 0) || (chunk >= num))
+        return 0;
+    return chunks[chunk].len / 12 + 1;
+}
+
+void VEchunks::parse(Chunk &chunk, VEdirect &parser, int index)
+{
+    int n = 0;
+    const char *buf = chunk.buf;
+    size_t len = chunk.len;
+    size_t used;
+    while (len > 0)
+    {
+        if (parser.parse(buf, len, used))
+        {
+            if (frameFunction != nullptr)
+                frameFunction(index, n, parser, frameContext);
+            n++;
+        }
+        buf += used;
+        len -= used;
+    }
+    chunk.numFrames = n;
+}
+
+void VEchunks::parseChunk(int chunk)
+{
+    if ((chunk < 0) || (chunk >= num) || (chunks[chunk].parser == nullptr))
+        return;
+    parse(chunks[chunk], *chunks[chunk].parser, chunk);
+}
+
+// merge in order: a parser not idle at end of its chunk continues with next chunk,
+// replacing results of that chunk, and might continue further on
+// NOTE parsers are used up, split() again before next analyze()
+int VEchunks::analyze(RunFunction run, FrameFunction frame, void *context)
+{
+    frameFunction = frame;
+    frameContext = context;
+    reparsed = 0;
+    run(*this, context);
+    int total = 0;
+    for (int k=0; k<num; k++)
+    {
+        total += chunks[k].numFrames;
+        if ((k + 1 < num) && (chunks[k].parser != nullptr) && !chunks[k].parser->idle())
+        { // chunk ended inside a block (e.g. HEX message), continue next chunk sequentially
+            parse(chunks[k + 1], *chunks[k].parser, k + 1);
+            delete chunks[k + 1].parser;
+            chunks[k + 1].parser = chunks[k].parser;
+            chunks[k].parser = nullptr;
+            reparsed++;
+        }
+    }
+    frameFunction = nullptr;
+    return total;
+}
+
+int VEchunks::numFrames(int chunk)
+{
+    if ((chunk < 0) || (chunk >= num))
+        return 0;
+    return chunks[chunk].numFrames;
+}
+
+int VEchunks::numReparsed()
+{
+    return reparsed;
+}
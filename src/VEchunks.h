@@ -0,0 +1,51 @@
+#ifndef _VECHUNKS_H_
+#define _VECHUNKS_H_
+
+#include <Arduino.h>
+#include "VEdirect.h"
+
+// offline analysis of a capture split in chunks at sync points (CR LF + first key + TAB),
+// each chunk parsed by its own parser (e.g. in parallel tasks or threads)
+// a chunk ending inside a block (e.g. HEX message) is continued by parsing the next chunk
+// again with the same parser, so results are identical to sequential parsing
+// NOTE parsers do not retain values, derived fields depending on history are not supported
+class VEchunks
+{
+public:
+    // called for every valid frame, frame = index within chunk
+    // a chunk parsed again calls it again from frame 0, so results of chunk are just overwritten
+    typedef void (*FrameFunction)(int chunk, int frame, VEdirect &parser, void *context);
+    // must call parseChunk() for all chunks 0...numChunks()-1, in any order or in parallel,
+    // and return when all chunks are done
+    typedef void (*RunFunction)(VEchunks &chunks, void *context);
+    VEchunks(const VEdirect::VEkey *VEkeys, int maxChunks);
+    ~VEchunks();
+    VEchunks(const VEchunks &) = delete;
+    VEchunks &operator=(const VEchunks &) = delete;
+    int split(const char *capture, size_t len); // split at sync points, return number of chunks
+    int numChunks();
+    int maxFrames(int chunk);                    // frames possible in chunk, e.g. to size results
+    void parseChunk(int chunk);                  // called by run function, chunks are independent
+    // parse all chunks using run function, then continue chunks ending inside a block,
+    // return total number of valid frames
+    int analyze(RunFunction run, FrameFunction frame, void *context);
+    int numFrames(int chunk);                    // valid frames of chunk after analyze()
+    int numReparsed();                           // number of chunks parsed again
+private:
+    typedef struct {
+        const char *buf;  // start of chunk, at a sync point (except first one)
+        size_t len;       // number of characters
+        VEdirect *parser; // kept to continue if chunk ends inside a block
+        int numFrames;    // number of valid frames
+    } Chunk;
+    const VEdirect::VEkey *keys;          // pointer to key names/digits
+    Chunk *chunks;
+    int maxNum;                           // chunks allocated
+    int num;                              // chunks used
+    int reparsed;
+    FrameFunction frameFunction;          // set while analyzing
+    void *frameContext;
+    void parse(Chunk &chunk, VEdirect &parser, int index); // parse chunk, reporting frames as chunk index
+};
+
+#endif
@@ -5,7 +5,9 @@
 // VERBOSE 2: + unparsed names (e.g. for setup of new device)
 // VERBOSE 3: + show parsing progress (trace level)
 
+#ifndef VERBOSE
 #define VERBOSE 2
+#endif
 
 VEdirect::VEdirect(const VEkey *VEkeys, bool retainValues) : 
     keys(VEkeys),
@@ -13,7 +15,16 @@ VEdirect::VEdirect(const VEkey *VEkeys, bool retainValues) :
     nFrameErrors(0),
     nFramesOK(0),
     state(waitCR),
-    valid(false)
+    valid(false),
+    historyLen(0),
+    derived(nullptr),
+    numDerived(0),
+    derivedState(nullptr),
+    derivedOrder(nullptr),
+    frameTime(0),
+    receiveTime(0),
+    useReceiveTime(false),
+    snapshot(nullptr)
 {
     for (numKeys = 0; numKeys<MAX_KEYS; numKeys++)
     {
@@ -39,6 +50,14 @@ VEdirect::VEdirect(const VEkey *VEkeys, bool retainValues) :
     tempValues = new String[numKeys];
 }
 
+VEdirect::~VEdirect()
+{
+    delete[] values;
+    delete[] tempValues;
+    delete[] derivedState;
+    delete[] derivedOrder;
+}
+
 void VEdirect::setRetain(bool retainValues) 
 { 
     retain = retainValues;
@@ -55,12 +74,309 @@ int VEdirect::findKey(const String name)
     return -1; // not found
 }
 
+// search keys first, then derived fields (index numKeys...)
+int VEdirect::findField(const String name)
+{
+    int index = findKey(name);
+    if (index >= 0)
+        return index;
+    for (index = 0; index < numDerived; index++)
+    {
+        if (name == derived[index].name)
+            return numKeys + index; // found
+    }
+    return -1; // not found
+}
+
+int VEdirect::fieldDigits(int index)
+{
+    if (index >= numKeys)
+        return derived[index - numKeys].digits;
+    return keys[index].digits;
+}
+
+// numerical value of key or derived field, NAN if empty or string
+float VEdirect::fieldValue(int index)
+{
+    if (index >= numKeys)
+    { // derived field
+        DerivedState &d = derivedState[index - numKeys];
+        return d.available ? d.value : NAN;
+    }
+    if ((values[index].length() == 0) || (keys[index].digits < 0))
+        return NAN;
+    float value = values[index].toInt(); // read raw as int
+    for (int i=0; i<keys[index].digits; i++)
+    {
+        value /= 10.0f; // respect number of decimals
+    }
+    return value;
+}
+
+// resolve source names and evaluation order once,
+// so updateDerived() just walks the arrays on every block
+bool VEdirect::setDerived(const VEderived *VEderivedKeys)
+{
+    int n;
+    for (n = 0; n < MAX_KEYS; n++)
+    {
+        if (VEderivedKeys[n].op == opEnd)
+            break; // found end of list marker
+    }
+    delete[] derivedState;
+    delete[] derivedOrder;
+    derived = VEderivedKeys;
+    numDerived = (n < MAX_KEYS) ? n : 0;
+    derivedState = new DerivedState[numDerived](); // all cleared, integrators not started
+    derivedOrder = new int[numDerived];
+    bool ok = (n < MAX_KEYS);
+    for (int i=0; ok && (i<numDerived); i++)
+    {
+        derivedState[i].a = findField(derived[i].a);
+        derivedState[i].b = (derived[i].b.length() > 0) ? findField(derived[i].b) : -1;
+        if ((derivedState[i].a < 0) || ((derived[i].b.length() > 0) && (derivedState[i].b < 0)))
+        {
+#if VERBOSE >= 1
+            Serial.print(derived[i].name);
+            Serial.println(": source of derived field not found");
+#endif
+            ok = false;
+        }
+    }
+    // order by dependency: a field is placed once all derived sources are placed
+    int placed = 0;
+    auto isPlaced = [&](int field) 
+    { // keys are always available, derived fields once in order list
+        if (field < numKeys)
+            return true;
+        for (int j=0; j<placed; j++)
+            if (derivedOrder[j] == field - numKeys)
+                return true;
+        return false;
+    };
+    while (ok && (placed < numDerived))
+    {
+        int before = placed;
+        for (int i=0; i<numDerived; i++)
+        {
+            if (!isPlaced(numKeys + i) && isPlaced(derivedState[i].a) && 
+                ((derivedState[i].b < 0) || isPlaced(derivedState[i].b)))
+                derivedOrder[placed++] = i;
+        }
+        if (placed == before)
+        {
+#if VERBOSE >= 1
+            Serial.println("derived fields with circular reference");
+#endif
+            ok = false;
+        }
+    }
+    if (!ok)
+        numDerived = 0; // mark as not valid
+    initSnapshot(); // field list changed
+    return ok;
+}
+
+void VEdirect::resetDerived()
+{
+    for (int i=0; i<numDerived; i++)
+    {
+        DerivedState &d = derivedState[i];
+        d.value = 0;
+        if (derived[i].op != opIntegrate)
+        { // integrators keep last sample to continue seamlessly
+            d.started = false;
+            d.available = false;
+        }
+    }
+}
+
+void VEdirect::setFrameTime(uint32_t time)
+{
+    receiveTime = time;
+    useReceiveTime = true;
+}
+
+// evaluate derived fields in dependency order, no memory allocated here
+void VEdirect::updateDerived()
+{
+    uint32_t now = useReceiveTime ? receiveTime : millis();
+    float dt = (now - frameTime) / 3600000.0f; // hours since last valid block
+    frameTime = now;
+    for (int n=0; n<numDerived; n++)
+    {
+        int i = derivedOrder[n];
+        DerivedState &d = derivedState[i];
+        float k = derived[i].k;
+        float a = fieldValue(d.a);
+        float b = (d.b < 0) ? NAN : fieldValue(d.b);
+        switch (derived[i].op)
+        {
+            case opProduct:
+                d.value = (d.b < 0) ? a * k : a * b * k;
+                d.available = !isnan(d.value);
+                break;
+            case opSum:
+                d.value = (d.b < 0) ? a : a + b * k;
+                d.available = !isnan(d.value);
+                break;
+            case opIntegrate:
+                if (isnan(a))
+                {
+                    d.started = false; // gap in data, restart with next sample
+                    break;
+                }
+                if (d.started)
+                    d.value += 0.5f * (d.last + a) * dt * k; // trapezoidal rule
+                d.last = a;
+                d.started = true;
+                d.available = true;
+                break;
+            case opEMA:
+                if (isnan(a))
+                    break; // keep last average
+                d.value = d.started ? d.value + k * (a - d.value) : a;
+                d.started = true;
+                d.available = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void VEdirect::setSnapshot(VEsnapshot *snapshotRecord)
+{
+    snapshot = snapshotRecord;
+    initSnapshot();
+}
+
+// field layout is written on setSnapshot() and setDerived(), readers detect changes by layout counter
+void VEdirect::initSnapshot()
+{
+    if (snapshot == nullptr)
+        return;
+    uint32_t seq = snapshot->sequence & ~1u; // might be odd if record was not initialized
+    __atomic_store_n(&snapshot->sequence, seq + 1, __ATOMIC_RELAXED); // odd, readers wait
+    __atomic_store_n(&snapshot->magic, 0, __ATOMIC_RELAXED); // mark as not valid while changing layout
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    int n = min(numKeys + numDerived, VESNAPSHOT_FIELDS);
+    for (int i=0; i<n; i++)
+    {
+        VEsnapshotField &f = snapshot->fields[i];
+        const String &name = (i < numKeys) ? keys[i].name : derived[i - numKeys].name;
+        strncpy(f.name, name.c_str(), VESNAPSHOT_NAME - 1);
+        f.name[VESNAPSHOT_NAME - 1] = 0;
+        f.digits = fieldDigits(i);
+        f.available = 0;
+        f.number = NAN;
+        f.text[0] = 0;
+    }
+    snapshot->version = VESNAPSHOT_VERSION;
+    snapshot->numFields = n;
+    snapshot->layout++; // indices found by readers before are not valid any more
+    snapshot->framesOK = nFramesOK;
+    snapshot->frameTime = frameTime;
+    __atomic_store_n(&snapshot->magic, VESNAPSHOT_MAGIC, __ATOMIC_RELAXED);
+    __atomic_store_n(&snapshot->sequence, seq + 2, __ATOMIC_RELEASE); // even, layout complete
+}
+
+// write values of valid block, no memory allocated here
+void VEdirect::publish()
+{
+    if (snapshot == nullptr)
+        return;
+    uint32_t seq = snapshot->sequence;
+    __atomic_store_n(&snapshot->sequence, seq + 1, __ATOMIC_RELAXED); // odd, readers wait
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i=0; i<snapshot->numFields; i++)
+    {
+        VEsnapshotField &f = snapshot->fields[i];
+        if (i < numKeys)
+        {
+            f.available = (values[i].length() > 0);
+            strncpy(f.text, values[i].c_str(), VESNAPSHOT_TEXT - 1);
+        }
+        else
+        {
+            f.available = derivedState[i - numKeys].available;
+            snprintf(f.text, VESNAPSHOT_TEXT, "%.*f", f.digits, f.available ? fieldValue(i) : 0.0f);
+        }
+        f.text[VESNAPSHOT_TEXT - 1] = 0;
+        f.number = fieldValue(i);
+    }
+    snapshot->framesOK = nFramesOK;
+    snapshot->frameTime = frameTime;
+    __atomic_store_n(&snapshot->sequence, seq + 2, __ATOMIC_RELEASE); // even, data complete
+}
+
+// a CR starts a new line, which might be the first one of a block
+void VEdirect::startBlock(char c)
+{
+    // clear temporary data
+    for (int i=0; i<numKeys; i++)
+        tempValues[i] = "";
+    chksum = c;
+    history[0] = c;
+    historyLen = 1;
+    state = waitLF;
+#if VERBOSE >= 3
+    Serial.println("VEdirect::parse starting block");
+#endif
+}
+
+// reset parser on invalid character
+// a CR might be the start of the next line already, so don't wait for another one
+void VEdirect::frameError(char c)
+{
+    nFrameErrors++; // increment error counter
+    state = waitCR; // invalid, reset parser
+    if (c == '\r')
+        startBlock(c);
+}
+
+// on checksum error search characters of the block for the start of another block 
+// (e.g. checksum line lost) with valid checksum up to the end and parse again from there
+bool VEdirect::recover()
+{
+    int start = 0;
+    uint8_t sum = 0; // checksum of characters before start
+    while (historyLen > 0)
+    {
+        int next = start + 1 + findSync(history + start + 1, historyLen - start - 1);
+        if (next >= historyLen)
+            return false; // no block found
+        for (; start < next; start++)
+            sum += history[start];
+        if ((uint8_t)(chksum - sum) == 0)
+        { // checksum of remaining characters valid
+#if VERBOSE >= 1
+            Serial.println("block recovered");
+#endif
+            int len = historyLen - start;
+            memmove(history, history + start, len); // characters are recorded again while parsing
+            state = waitCR;
+            bool done = false;
+            for (int i=0; i<len; i++)
+                done = parse(history[i]);
+            return done;
+        }
+    }
+    return false;
+}
+
 // assemble a line from input, parse on newline
-// TODO exclude Victron HEX packets from parsing
 bool VEdirect::parse(char c)
 {
-    if (c == ':') // a binary message can interrupt a text message at any time
-    { 
+    if ((state != waitCR) && (state != binMessage) && (historyLen >= 0))
+    { // record characters of block for recovery
+        if (historyLen < VEDIRECT_LOOKBACK)
+            history[historyLen++] = c;
+        else
+            historyLen = -1; // too long, no recovery for this block
+    }
+    if ((c == ':') && (state != getChksum)) // a binary message can interrupt a text message at any time
+    { // NOTE checksum could be any byte, including ':' 
 #if VERBOSE >= 2
         Serial.print("\r\nbinary message '");
 #endif
@@ -76,30 +392,26 @@ bool VEdirect::parse(char c)
 #endif
                 state = waitCR;
             }
+            else if (c == '\r') // not part of binary message, so text message resumed
+            {
+#if VERBOSE >= 2
+                Serial.print("' aborted\r\n");
+#endif
+                startBlock(c);
+                break;
+            }
 #if VERBOSE >= 2
             Serial.print(c);    
 #endif
             break;
         case waitCR:
             if (c == '\r') // a new line might start a new block of data (if it is the first one)
-            {
-                // clear temporary data
-                for (int i=0; i<numKeys; i++)
-                    tempValues[i] = "";
-                chksum = c;
-                state = waitLF;
-#if VERBOSE >= 3
-                Serial.println("VEdirect::parse starting block");
-#endif
-            }
+                startBlock(c);
             break;
         case waitLF: // every CR to be followed by LF
             chksum += c; // update checksum
             if (c != '\n')
-            {
-                nFrameErrors++; // increment error counter
-                state = waitCR; // invalid, reset parser
-            }
+                frameError(c);
             else
             {
                 state = getName;
@@ -140,8 +452,7 @@ bool VEdirect::parse(char c)
                 name += c; // name must not hold control characters
             else // reset parser
             {
-                nFrameErrors++; // increment error counter
-                state = waitCR; // anything else will reset parsing
+                frameError(c); // anything else will reset parsing
 #if VERBOSE >= 1
                 Serial.println("name with invalid characters");
 #endif
@@ -163,8 +474,7 @@ bool VEdirect::parse(char c)
                 value += c; // assemble value
             else
             {
-                nFrameErrors++; // increment error counter
-                state = waitCR; // anything else will reset parsing
+                frameError(c); // anything else will reset parsing
 #if VERBOSE >= 1
                 Serial.println("value with invalid characters");
 #endif
@@ -176,8 +486,7 @@ bool VEdirect::parse(char c)
                 state = waitLF; // we expect a LF next
             else if (!isPrintable(c))
             {
-                nFrameErrors++; // increment error counter
-                state = waitCR; // anything else will reset parsing
+                frameError(c); // anything else will reset parsing
 #if VERBOSE >= 1
                 Serial.println("value with invalid characters");
 #endif
@@ -194,6 +503,8 @@ bool VEdirect::parse(char c)
             if (!tempValid)
                 Serial.println("Checksum error");
 #endif
+            if (!tempValid && recover())
+                return true; // block following in characters received is valid
             if (tempValid) // copy to public data
             {
                 nFramesOK++; // increment frames OK counter
@@ -205,6 +516,8 @@ bool VEdirect::parse(char c)
                         values[i] = ""; // clear existing data
                 }
                 valid = true;
+                updateDerived();
+                publish();
             }
             else if (!retain)
             {
@@ -232,6 +545,61 @@ bool VEdirect::parse(Stream& s)
     return false;
 }
 
+// parse from buffer, aborting if a valid frame has been read
+// used returns the number of characters consumed, continue from there
+bool VEdirect::parse(const char *buf, size_t len, size_t &used)
+{
+    used = 0;
+    while (used < len)
+    {
+        if (parse(buf[used++]))
+            return true; // abort parsing after full and valid message has been received
+    }
+    return false;
+}
+
+// non blocking parser from ring buffer, processing contiguous characters received at same time
+// aborting if a valid frame has been read
+bool VEdirect::parse(VEring &ring)
+{
+    const char *data;
+    size_t len;
+    uint32_t time;
+    while ((len = ring.peek(data, time)) > 0)
+    {
+        size_t used;
+        setFrameTime(time);
+        bool done = parse(data, len, used);
+        ring.consume(used);
+        if (done)
+            return true; // abort parsing after full and valid message has been received
+    }
+    return false;
+}
+
+// a block is expected to start with the first key in list, 
+// so CR LF + name + TAB is a safe point to start parsing of a chunk
+size_t VEdirect::findSync(const char *buf, size_t len)
+{
+    if (numKeys == 0)
+        return len; // keys not valid
+    const char *first = keys[0].name.c_str();
+    size_t n = keys[0].name.length();
+    const char *end = buf + len;
+    for (const char *p = buf; (p = (const char *)memchr(p, '\r', end - p)) != nullptr; p++)
+    {
+        if (((size_t)(end - p) >= n + 3) && (p[1] == '\n') && (memcmp(p + 2, first, n) == 0) && (p[n + 2] == '\t'))
+            return p - buf;
+    }
+    return len; // not found
+}
+
+// a parser started at a sync point behaves the same as one being idle there
+bool VEdirect::idle()
+{
+    return state == waitCR;
+}
+
 // return frameing errors counter
 uint VEdirect::numFrameErrors()
 {
@@ -264,7 +632,7 @@ int VEdirect::hasField(const String name)
 #endif
         return -1;
     }
-    int index = findKey(name);
+    int index = findField(name);
     if (index < 0) // name available?
     {   
 #if VERBOSE >= 3
@@ -272,7 +640,8 @@ int VEdirect::hasField(const String name)
 #endif
         return -2; 
     }
-    if (values[index].length() == 0) // value not empty?
+    bool empty = (index < numKeys) ? (values[index].length() == 0) : !derivedState[index - numKeys].available;
+    if (empty) // value not empty?
     {
 #if VERBOSE >= 3
         Serial.println("value empty");
@@ -287,6 +656,8 @@ String VEdirect::readString(const String name)
     int index = hasField(name);
     if (index < 0)
         return "";
+    if (index >= numKeys) // derived field
+        return String(fieldValue(index), fieldDigits(index));
     return values[index];
 }
 
@@ -295,13 +666,15 @@ int VEdirect::readInt(const String name)
     int index = hasField(name);
     if (index < 0)
         return 0;
-    if (keys[index].digits != 0)
+    if (fieldDigits(index) != 0)
     {
 #if VERBOSE >= 3
         Serial.println("not an integer");
 #endif
         return 0;
     }
+    if (index >= numKeys) // derived field
+        return lroundf(fieldValue(index));
     if (values[index].startsWith("0x"))
         return strtol(values[index].substring(2).c_str(), nullptr, 16);
     else
@@ -313,13 +686,15 @@ uint32_t VEdirect::readU32(const String name)
     int index = hasField(name);
     if (index < 0)
         return 0;
-    if (keys[index].digits != 0)
+    if (fieldDigits(index) != 0)
     {
 #if VERBOSE >= 3
         Serial.println("not an integer");
 #endif
         return 0;                
     }
+    if (index >= numKeys) // derived field
+        return lroundf(fieldValue(index));
     if (values[index].startsWith("0x"))
         return strtoul(values[index].substring(2).c_str(), nullptr, 16);
     else
@@ -331,19 +706,14 @@ float VEdirect::readFloat(const String name)
     int index = hasField(name);
     if (index < 0)
         return NAN;
-    if (keys[index].digits < 0)
+    if (fieldDigits(index) < 0)
     {
 #if VERBOSE >= 3
         Serial.println("not a number");
 #endif
         return NAN;
     }
-    float value = values[index].toInt(); // read raw as int
-    for (int i=0; i<keys[index].digits; i++)
-    {
-        value /= 10.0f; // respect number of decimals
-    }
-    return value;
+    return fieldValue(index);
 }
 
 // deal with undefined values depending on allFields
@@ -383,6 +753,17 @@ String VEdirect::asJson(bool allFields)
             jsonString += ",\n"; // data is already existing, add as next field
         jsonString += jsonLine; // add actual data
     }
+    for (int i=0; i<numDerived; i++)
+    {
+        String jsonLine = "";
+        if (derivedState[i].available)
+            jsonLine = "\"" + derived[i].name + "\":" + String(derivedState[i].value, derived[i].digits);
+        else if (allFields)
+            jsonLine = "\"" + derived[i].name + "\":null";
+        if ((jsonString.length() > 0) && (jsonLine.length() > 0))
+            jsonString += ",\n"; // data is already existing, add as next field
+        jsonString += jsonLine; // add actual data
+    }
     return "{\n" + jsonString + "\n}";
 }
 
@@ -396,6 +777,12 @@ bool VEdirect::printRaw(Stream &s)
             s.print(" = ");
             s.println(values[i]);
         }
+        for (int i=0; i<numDerived; i++)
+        {
+            s.print(derived[i].name);
+            s.print(" = ");
+            s.println(readString(derived[i].name));
+        }
     }
   return valid;
 }
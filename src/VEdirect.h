@@ -2,6 +2,13 @@
 #define _VEDIRECT_H_
 
 #include <Arduino.h>
+#include "VEsnapshot.h"
+#include "VEring.h"
+
+// number of characters of a block kept to recover from errors (e.g. lost checksum line)
+#ifndef VEDIRECT_LOOKBACK
+#define VEDIRECT_LOOKBACK 512
+#endif
 
 class VEdirect 
 {
@@ -16,14 +23,39 @@ public:
     typedef struct {String name; int digits;} VEkey; 
     // initialize to use specified key names to record, keep older values if retainValues = true
     VEdirect(const VEkey *VEkeys, bool retainValues=true);
+    ~VEdirect();
+    VEdirect(const VEdirect &) = delete;
+    VEdirect &operator=(const VEdirect &) = delete;
     void setRetain(bool retainValues);
+    // derived fields, calculated from recorded keys (or other derived fields) on every valid block
+    // a, b: source field names, b may be empty if not used by operator
+    // op:
+    //  opProduct   = a * b * k (b optional), e.g. power from voltage and current
+    //  opSum       = a + b * k (b optional), e.g. k = -1 for difference of currents
+    //  opIntegrate = sum of a * k over time [h] (trapezoidal), e.g. Ah from current or Wh from power
+    //  opEMA       = exponential moving average of a, weight 0 < k <= 1 for new value
+    //  opEnd       = end of list, name not used
+    enum VEop {opProduct, opSum, opIntegrate, opEMA, opEnd};
+    typedef struct {String name; int digits; VEop op; String a; String b; float k;} VEderived;
+    bool setDerived(const VEderived *VEderivedKeys); // return false if sources not found or circular
+    void resetDerived();   // restart integration and averages, e.g. at midnight
+    // receive time of characters parsed next (e.g. from capture), used as time of block completed
+    // for integration and snapshot, millis() at end of block if never set
+    void setFrameTime(uint32_t time);
+    // publish every valid block to snapshot record (e.g. in shared memory), nullptr to stop
+    void setSnapshot(VEsnapshot *snapshotRecord);
     // parse functions return true if a full message has been successfully received
     bool parse(char c);    // single character
     bool parse(Stream &s); // non blocking read from selected stream, e.g. serial
+    bool parse(const char *buf, size_t len, size_t &used); // from buffer, used returns characters consumed
+    bool parse(VEring &ring); // non blocking read from ring buffer, e.g. filled by UART interrupt or task
+    // offline processing of captured data split in chunks
+    size_t findSync(const char *buf, size_t len); // position of next CR LF + first key + TAB, len if none
+    bool idle();           // true if waiting for start of block, e.g. at end of chunk
     uint numFrameErrors(); // counter of framing errors
     uint numFramesOK();    // counter of frames received OK
     bool dataValid();      // return true if a valid block has been received
-    // access to data once valid package is complete 
+    // access to data once valid package is complete, derived fields accessed same way
     int hasField(const String name);      // return name index if data available (data valid, name existing, value not empty)
     String readString(const String name); // read any value as string (raw format for floats)
     int readInt(const String name);       // read value as int, 0 if not valid
@@ -80,8 +112,29 @@ private:
     String name;                          // temporary field name, max. 9 characters
     String value;                         // temporary value, max. 33 characters
     uint8_t chksum;                       // updated while receiving a block
+    char history[VEDIRECT_LOOKBACK];      // characters of block received, used to recover
+    int historyLen;                       // number of characters in history, -1 if exceeded
+    void startBlock(char c);              // CR received, start of block (or line)
+    void frameError(char c);              // invalid character, reset parser
+    bool recover();                       // parse again from block start found in history
     int keyIndex;                         // used to store index while parsing name/value pairs
     int findKey(const String name);       // check a key is in list
+    // derived fields, index numKeys... in field numbering
+    typedef struct {int a; int b; float value; float last; bool available; bool started;} DerivedState;
+    const VEderived *derived;             // pointer to derived field definitions
+    int numDerived;                       // number of derived fields
+    DerivedState *derivedState;           // calculated values
+    int *derivedOrder;                    // evaluation order, sources first
+    uint32_t frameTime;                   // time of last valid block, used for integration
+    uint32_t receiveTime;                 // set by setFrameTime()
+    bool useReceiveTime;                  // use receiveTime instead of millis()
+    void updateDerived();                 // evaluate derived fields, called on valid block
+    int findField(const String name);     // check a key or derived field is in list
+    int fieldDigits(int index);           // number of digits of key or derived field
+    float fieldValue(int index);          // value of key or derived field, NAN if not available
+    VEsnapshot *snapshot;                 // record to publish valid blocks to
+    void initSnapshot();                  // write layout (field names) to snapshot
+    void publish();                       // write values to snapshot, called on valid block
 };
 
 #endif
@@ -0,0 +1,162 @@
+#include "VEring.h"
+
+// positions are free running counters, index into buffer is position & mask
+// head and tail are written by one side only, so atomic load/store is all we need
+
+static size_t powerOf2(size_t n)
+{
+    size_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+VEring::VEring(size_t size, size_t maxChunks) :
+    headPos(0),
+    tailPos(0),
+    chunkHead(0),
+    chunkTail(0),
+    overruns(0),
+    lostTimes(0),
+    headTime(0),
+    lastTime(0)
+{
+    size = powerOf2(size);
+    maxChunks = (maxChunks == 0) ? size : powerOf2(maxChunks);
+    buf = new char[size];
+    mask = size - 1;
+    chunks = new Chunk[maxChunks];
+    chunkMask = maxChunks - 1;
+}
+
+VEring::~VEring()
+{
+    delete[] buf;
+    delete[] chunks;
+}
+
+size_t IRAM_ATTR VEring::write(const char *data, size_t len, uint32_t time)
+{
+    uint32_t head = headPos;
+    uint32_t tail = __atomic_load_n(&tailPos, __ATOMIC_ACQUIRE);
+    size_t space = mask + 1 - (head - tail);
+    size_t n = (len < space) ? len : space;
+    size_t offset = head & mask;
+    size_t first = (n < mask + 1 - offset) ? n : mask + 1 - offset; // up to end of buffer
+    memcpy(buf + offset, data, first);
+    memcpy(buf, data + first, n - first);
+    commit(head, n, len - n, time);
+    return n;
+}
+
+// read directly into buffer, characters not fitting are read and dropped
+size_t VEring::write(Stream &s, uint32_t time)
+{
+    int avail = s.available();
+    if (avail <= 0)
+        return 0;
+    uint32_t head = headPos;
+    uint32_t tail = __atomic_load_n(&tailPos, __ATOMIC_ACQUIRE);
+    size_t space = mask + 1 - (head - tail);
+    size_t n = ((size_t)avail < space) ? avail : space;
+    size_t offset = head & mask;
+    size_t first = (n < mask + 1 - offset) ? n : mask + 1 - offset; // up to end of buffer
+    size_t got = s.readBytes(buf + offset, first);
+    if ((got == first) && (n > first))
+        got += s.readBytes(buf, n - first);
+    size_t dropped = 0;
+    for (size_t i=n; i<(size_t)avail; i++, dropped++)
+        s.read(); // no space left
+    commit(head, got, dropped, time);
+    return got;
+}
+
+// timestamp is recorded if there is space left, else it is counted as lost and characters are
+// accounted to the next chunk recorded (or time of last write), so times reported are never older
+// chunks kept all end after tail, so one chunk per character never overflows
+void IRAM_ATTR VEring::commit(uint32_t head, size_t n, size_t dropped, uint32_t time)
+{
+    if (dropped > 0)
+        __atomic_store_n(&overruns, overruns + dropped, __ATOMIC_RELAXED);
+    if (n == 0)
+        return;
+    __atomic_store_n(&headTime, time, __ATOMIC_RELAXED); // published by headPos
+    uint32_t ch = chunkHead;
+    if (ch - __atomic_load_n(&chunkTail, __ATOMIC_ACQUIRE) <= chunkMask)
+    {
+        chunks[ch & chunkMask].end = head + n;
+        chunks[ch & chunkMask].time = time;
+        __atomic_store_n(&chunkHead, ch + 1, __ATOMIC_RELEASE);
+    }
+    else
+        __atomic_store_n(&lostTimes, lostTimes + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&headPos, head + n, __ATOMIC_RELEASE); // characters visible to consumer
+}
+
+uint32_t VEring::numOverruns()
+{
+    return __atomic_load_n(&overruns, __ATOMIC_RELAXED);
+}
+
+uint32_t VEring::numLostTimes()
+{
+    return __atomic_load_n(&lostTimes, __ATOMIC_RELAXED);
+}
+
+size_t VEring::available()
+{
+    return __atomic_load_n(&headPos, __ATOMIC_ACQUIRE) - tailPos;
+}
+
+// characters might wrap at end of buffer, so call again after consume()
+size_t VEring::peek(const char *&data)
+{
+    size_t avail = __atomic_load_n(&headPos, __ATOMIC_ACQUIRE) - tailPos;
+    size_t offset = tailPos & mask;
+    data = buf + offset;
+    return (avail < mask + 1 - offset) ? avail : mask + 1 - offset;
+}
+
+// chunks are published before characters, so chunk of first character is known
+size_t VEring::peek(const char *&data, uint32_t &time)
+{
+    size_t len = peek(data);
+    uint32_t ch = __atomic_load_n(&chunkHead, __ATOMIC_ACQUIRE);
+    uint32_t ct = chunkTail;
+    if (ct != ch)
+    {
+        size_t n = chunks[ct & chunkMask].end - tailPos;
+        time = chunks[ct & chunkMask].time;
+        if (n < len)
+            len = n;
+    }
+    else
+        time = __atomic_load_n(&headTime, __ATOMIC_RELAXED); // timestamp lost, newer than characters peeked
+    return len;
+}
+
+void VEring::consume(size_t len)
+{
+    if (len == 0)
+        return;
+    uint32_t tail = tailPos + len;
+    uint32_t ch = __atomic_load_n(&chunkHead, __ATOMIC_ACQUIRE);
+    uint32_t ct = chunkTail;
+    while ((ct != ch) && ((int32_t)(chunks[ct & chunkMask].end - tail) < 0))
+        ct++; // chunk completely consumed before last character
+    if (ct != ch)
+    { // chunk holding last character consumed
+        lastTime = chunks[ct & chunkMask].time;
+        if (chunks[ct & chunkMask].end == tail)
+            ct++; // completely consumed
+    }
+    else
+        lastTime = __atomic_load_n(&headTime, __ATOMIC_RELAXED); // timestamp lost, newer than characters peeked
+    __atomic_store_n(&chunkTail, ct, __ATOMIC_RELEASE);
+    __atomic_store_n(&tailPos, tail, __ATOMIC_RELEASE); // space available to producer
+}
+
+uint32_t VEring::timestamp()
+{
+    return lastTime;
+}
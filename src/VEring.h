@@ -0,0 +1,51 @@
+#ifndef _VERING_H_
+#define _VERING_H_
+
+#include <Arduino.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR // place code in RAM to be called from interrupts (ESP32, ESP8266)
+#endif
+
+// lock free ring buffer with one producer (interrupt, UART task or reader thread)
+// and one consumer (parser), so receiving does not depend on time spent processing frames
+// characters not fitting into buffer are dropped and counted
+class VEring
+{
+public:
+    // size of buffer rounded up to power of 2, maxChunks = number of receive timestamps kept
+    // every write needs one timestamp, so default (0) is one per character, which never overflows
+    // fewer timestamps save memory (8 bytes each), but times are lost if writes are small
+    VEring(size_t size=1024, size_t maxChunks=0);
+    ~VEring();
+    VEring(const VEring &) = delete;
+    VEring &operator=(const VEring &) = delete;
+    // producer
+    size_t write(const char *data, size_t len, uint32_t time); // return characters stored
+    size_t write(Stream &s, uint32_t time); // all characters available from stream, e.g. serial
+    uint32_t numOverruns();                 // counter of characters dropped
+    uint32_t numLostTimes();                // counter of timestamps dropped (too few maxChunks)
+    // consumer
+    size_t available();                     // characters in buffer
+    size_t peek(const char *&data);         // return number of contiguous characters at data
+    size_t peek(const char *&data, uint32_t &time); // same, but just characters received at time
+    void consume(size_t len);               // release characters processed
+    uint32_t timestamp();                   // receive time of last character consumed, newer if lost
+private:
+    typedef struct {uint32_t end; uint32_t time;} Chunk; // position after chunk, receive time
+    char *buf;                            // characters received
+    size_t mask;                          // size - 1
+    uint32_t headPos;                     // written by producer, free running
+    uint32_t tailPos;                     // written by consumer, free running
+    Chunk *chunks;                        // receive timestamps
+    size_t chunkMask;                     // maxChunks - 1
+    uint32_t chunkHead;                   // written by producer
+    uint32_t chunkTail;                   // written by consumer
+    uint32_t overruns;                    // written by producer
+    uint32_t lostTimes;                   // written by producer
+    uint32_t headTime;                    // time of last write, written by producer
+    uint32_t lastTime;                    // used by consumer only
+    void commit(uint32_t head, size_t n, size_t dropped, uint32_t time); // publish characters written
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef _VESNAPSHOT_H_
+#define _VESNAPSHOT_H_
+
+// snapshot of the latest valid block of a device, written by VEdirect::setSnapshot()
+// the record could be placed in any memory shared with readers, e.g. a global used by
+// other tasks or a shared memory segment (shm_open/mmap) read by other processes on a host
+// no dependency on Arduino, so readers could include this file only
+
+#include <stdint.h>
+#include <string.h>
+
+#define VESNAPSHOT_MAGIC   0x31534556 // "VES1"
+#define VESNAPSHOT_VERSION 2
+#define VESNAPSHOT_FIELDS  64         // maximum number of fields (keys + derived)
+#define VESNAPSHOT_NAME    10         // field name, max. 9 characters + 0
+#define VESNAPSHOT_TEXT    34         // value, max. 33 characters + 0
+
+typedef struct {
+    char name[VESNAPSHOT_NAME];   // field name
+    int8_t digits;                // number of fractional digits, -1 = string (see VEkey)
+    uint8_t available;            // 1 if value has been received
+    float number;                 // value as float, NAN if string or not available
+    char text[VESNAPSHOT_TEXT];   // value as string (raw format for keys)
+} VEsnapshotField;
+
+// protected by sequence counter (seqlock), odd while writer is updating
+// readers never block the writer, they just retry if sequence has changed
+typedef struct {
+    uint32_t magic;               // VESNAPSHOT_MAGIC once initialized
+    uint16_t version;             // VESNAPSHOT_VERSION
+    uint16_t numFields;           // number of fields used
+    uint32_t sequence;            // incremented before and after writing
+    uint32_t layout;              // incremented whenever field list changes (e.g. setDerived)
+    uint32_t framesOK;            // counter of frames received OK
+    uint32_t frameTime;           // time of block received, millis() or VEdirect::setFrameTime()
+    VEsnapshotField fields[VESNAPSHOT_FIELDS];
+} VEsnapshot;
+
+// field found by VEsnapshotFind(), valid as long as layout is not changed
+typedef struct {int index; uint32_t layout;} VEsnapshotRef;
+
+// reads of sequence while writer is updating before giving up, so readers do not hang
+// if writer died while updating (e.g. other process) or is not scheduled (same core, lower priority)
+#ifndef VESNAPSHOT_TRIES
+#define VESNAPSHOT_TRIES 100000
+#endif
+
+// read consistent data:
+//   uint32_t seq;
+//   do {
+//       if (!VEsnapshotBegin(s, seq)) ... writer not responding, try again later
+//       if (!VEsnapshotCurrent(s, ref)) ... layout changed, find fields again
+//       ... read any fields needed
+//   } while (VEsnapshotRetry(s, seq));
+
+// wait for writer to complete, seq to check with VEsnapshotRetry(), false if writer does not complete
+inline bool VEsnapshotBegin(const VEsnapshot *s, uint32_t &seq)
+{
+    for (int i=0; i<VESNAPSHOT_TRIES; i++)
+    {
+        seq = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0)
+            return true; // writer not active
+    }
+    return false;
+}
+
+// true if data has been updated while reading
+inline bool VEsnapshotRetry(const VEsnapshot *s, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->sequence, __ATOMIC_RELAXED) != seq;
+}
+
+// find field by name, index -1 if not found, record not initialized or writer not responding
+inline VEsnapshotRef VEsnapshotFind(const VEsnapshot *s, const char *name)
+{
+    VEsnapshotRef ref;
+    uint32_t seq;
+    for (int tries=0; tries<VESNAPSHOT_TRIES; tries++)
+    {
+        ref.index = -1;
+        if (!VEsnapshotBegin(s, seq))
+            break;
+        ref.layout = s->layout;
+        if ((s->magic == VESNAPSHOT_MAGIC) && (s->version == VESNAPSHOT_VERSION))
+        {
+            for (int i=0; (i < s->numFields) && (i < VESNAPSHOT_FIELDS); i++)
+            {
+                if (strncmp(s->fields[i].name, name, VESNAPSHOT_NAME) == 0)
+                {
+                    ref.index = i;
+                    break;
+                }
+            }
+        }
+        if (!VEsnapshotRetry(s, seq))
+            return ref;
+    }
+    ref.index = -1;
+    ref.layout = 0;
+    return ref;
+}
+
+// true if field found is still valid, check while reading (sequence locked)
+inline bool VEsnapshotCurrent(const VEsnapshot *s, VEsnapshotRef ref)
+{
+    return (ref.index >= 0) && (ref.index < s->numFields) && (s->layout == ref.layout);
+}
+
+// read single value as float, return false if not available, layout changed or writer not responding
+inline bool VEsnapshotReadFloat(const VEsnapshot *s, VEsnapshotRef ref, float &value)
+{
+    uint32_t seq;
+    for (int tries=0; tries<VESNAPSHOT_TRIES; tries++)
+    {
+        if (!VEsnapshotBegin(s, seq) || !VEsnapshotCurrent(s, ref))
+            return false; // try again later or find field again
+        bool available = s->fields[ref.index].available && (s->fields[ref.index].digits >= 0);
+        value = s->fields[ref.index].number;
+        if (!VEsnapshotRetry(s, seq))
+            return available;
+    }
+    return false;
+}
+
+// read single value as string (size including terminating 0),
+// return false if not available, layout changed or writer not responding
+inline bool VEsnapshotReadText(const VEsnapshot *s, VEsnapshotRef ref, char *text, size_t size)
+{
+    if (size == 0)
+        return false;
+    uint32_t seq;
+    for (int tries=0; tries<VESNAPSHOT_TRIES; tries++)
+    {
+        if (!VEsnapshotBegin(s, seq) || !VEsnapshotCurrent(s, ref))
+            return false; // try again later or find field again
+        bool available = s->fields[ref.index].available;
+        size_t len = (size < VESNAPSHOT_TEXT) ? size - 1 : VESNAPSHOT_TEXT - 1;
+        strncpy(text, s->fields[ref.index].text, len); // might be updated while copying
+        text[len] = 0;
+        if (!VEsnapshotRetry(s, seq))
+            return available;
+    }
+    return false;
+}
+
+#endif